@@ -0,0 +1,44 @@
+#include "../all_functions.h"
+#include "../load_generator.h"
+#include <stdio.h>
+
+int main(){
+    bool flag = true;
+
+    /* Histogram buckets: every value fits in its bucket, and the buckets are contiguous */
+    unsigned long long values[4] = {15, 16, 17, 1ULL << 40};
+    int indices[4] = {15, 16, 16, 304};
+    for(int i = 0; i < 4; i++){
+        int idx = load_hist_index(values[i]);
+        unsigned long long upper = load_hist_upper(idx);
+        if(idx != indices[i] || upper < values[i] || load_hist_index(upper) != idx || load_hist_index(upper + 1) != idx + 1)
+            flag = false;
+    }
+
+    /* Quantiles of a known histogram: 90 x 5us, 9 x 100us, 1 x 1000us */
+    load_hist[load_hist_index(5)] = 90;
+    load_hist[load_hist_index(100)] = 9;
+    load_hist[load_hist_index(1000)] = 1;
+    load_hist_total = 100;
+    load_hist_max = 1000;
+    if(fabs(load_hist_quantile(0.5) - 0.005) > 1e-9 || fabs(load_hist_quantile(0.99) - 0.103) > 1e-9
+       || fabs(load_hist_quantile(0.999) - 1.0) > 1e-9)
+        flag = false;
+
+    /* Timeval helpers carry over the microseconds */
+    struct timeval a = {10, 900000};
+    struct timeval b = timeval_add(a, 0.2);
+    if(b.tv_sec != 11 || b.tv_usec != 100000 || fabs(timeval_diff(a, b) - 0.2) > 1e-9)
+        flag = false;
+
+    /* enQueue_at keeps the arrival time it is given */
+    enQueue_at(&queue_front, &queue_rear, 20, 5, a);
+    if(queue_rear == NULL || queue_rear->arrival_time.tv_sec != 10 || queue_rear->arrival_time.tv_usec != 900000)
+        flag = false;
+
+    if(flag){
+        printf("Test #10 passed\n");
+    }else{
+        printf("Test #10 failed\n");
+    }
+}
@@ -0,0 +1,64 @@
+#define PROFILE
+#include "../all_functions.h"
+#include <stdio.h>
+
+struct prof_thread *allocator_prof = NULL;
+
+/* Wakes the allocator once without freeing memory, and then frees enough memory for its request */
+void* releaser_thr(void *dummy){
+    pthread_mutex_lock(&mutex);    /* Only available once the allocator waits on cond_memory */
+    pthread_cond_broadcast(&cond_memory);
+    pthread_mutex_unlock(&mutex);
+    while(true){
+        pthread_mutex_lock(&mutex);
+        if(allocator_prof->spurious_wakeups[PROF_COND_MEMORY] == 1){ /* The allocator is waiting again */
+            memory[0] = 0;
+            memory[1] = 0;
+            pthread_cond_broadcast(&cond_memory);
+            pthread_mutex_unlock(&mutex);
+            break;
+        }
+        pthread_mutex_unlock(&mutex);
+        usleep(1000);
+    }
+    return NULL;
+}
+
+int main(){
+    int arr1[10] = {1,1,0,0,0,1,1,0,0,0};
+    memory = (int *)malloc(sizeof(int) * 10);
+    for(int i = 0; i < 10; i++){
+        memory[i] = arr1[i];
+    }
+    num_memory_cells = 10;
+    pthread_mutex_init(&mutex, NULL);
+    pthread_cond_init(&cond_memory, NULL);
+    PROF_INIT();
+    PROF_THREAD_START("allocator", PROF_EVENTS_LONG_LIVED);
+    allocator_prof = prof_get();
+    enQueue(&queue_front, &queue_rear, 20, 10000);
+    PROF_LOCK(&mutex);
+    allocate_using_first_fit();
+    PROF_UNLOCK(&mutex);
+    struct prof_thread *th = allocator_prof;
+    bool flag = (th->lock_acquires == 1 && th->scans == 1 && th->num_events == 3 && th->cond_waits[PROF_COND_MEMORY] == 0);
+
+    /* With the memory full, the allocator is woken once while its request still does not fit */
+    for(int i = 0; i < 10; i++){
+        memory[i] = 1;
+    }
+    pthread_t thr_id;
+    enQueue(&queue_front, &queue_rear, 20, 10000);
+    PROF_LOCK(&mutex);
+    pthread_create(&thr_id, NULL, releaser_thr, NULL);
+    allocate_using_first_fit();
+    PROF_UNLOCK(&mutex);
+    pthread_join(thr_id, NULL);
+    flag = flag && (th->cond_waits[PROF_COND_MEMORY] == 2 && th->spurious_wakeups[PROF_COND_MEMORY] == 1 && th->scans == 4);
+
+    if(flag){
+        printf("Test #9 passed\n");
+    }else{
+        printf("Test #9 failed\n");
+    }
+}
@@ -7,6 +7,7 @@
 #include <unistd.h>
 #include <math.h>
 #include <sys/time.h>
+#include "profiler.h"
 
 /*Structure to store the parameters required to specify a request*/
 struct node{
@@ -44,6 +45,10 @@ int next_idx_of_last_allocated = 0;  /* Index of the location just after the mem
 int total_allocated_processes = 0;   /* Total number of processes which are allocated memory during the execution */
 double total_turnaround_time = 0;    /* Total turnaround time for all the processes, which are allocated memory during execution */
 
+bool verbose = true;    /* Whether every request, allocation and release of memory is logged */
+long long duration_unit_us = 1000000;   /* Length of one unit of the process duration, in microseconds */
+void (*allocation_hook)(double time_taken) = NULL;  /* If set, called with the mutex held whenever a request is allocated memory */
+
 pthread_mutex_t mutex;  /* Mutex lock */
 
 pthread_cond_t cond_queue;    /* Conditional Variable */
@@ -64,25 +69,31 @@ int random_integer_interval(int a, int b){
     return (rand()%(b - a)) + a;
 }
 
+/* Generate a random integer from a to b, using the caller's own seed so that concurrent threads do not contend */
+int random_integer_interval_r(unsigned int *seed, int a, int b){
+    return (rand_r(seed)%(b - a)) + a;
+}
+
 void log_msg(const char *msg, bool terminate) {
     printf("%s\n", msg);
     if (terminate) exit(-1); /* failure */
 }
 
 /**
- * Function to add a request at the rear end of the queue.
+ * Function to add a request at the rear end of the queue, with the given arrival time.
  * @param front Double pointer to the front of the queue.
  * @param rear Double pointer to the rear of the queue.
  * @param s Size of the process, in the current request.
  * @param d Duration of the process, in the current request.
+ * @param arrival Time from which the turnaround time of the request is measured.
  */
-void enQueue(struct node **front, struct node **rear, int s, int d){
+void enQueue_at(struct node **front, struct node **rear, int s, int d, struct timeval arrival){
     struct node *newNode = (struct node*)malloc(sizeof(struct node));
     newNode->size = s;
     newNode->duration = d;
     newNode->process_number = count;
     newNode->next =NULL;
-    gettimeofday(&(newNode->arrival_time), NULL);
+    newNode->arrival_time = arrival;
 
     if (*front == NULL && *rear == NULL) {
         *front = newNode; *rear = newNode;
@@ -91,10 +102,24 @@ void enQueue(struct node **front, struct node **rear, int s, int d){
         (*rear)->next = newNode;
         *rear = newNode;
     }
-    printf("Request is added to the queue for process %d, with size = %d and duration = %d\n", count, s, d);
+    if(verbose)
+        printf("Request is added to the queue for process %d, with size = %d and duration = %d\n", count, s, d);
     count += 1;
 }
 
+/**
+ * Function to add a request at the rear end of the queue, arriving now.
+ * @param front Double pointer to the front of the queue.
+ * @param rear Double pointer to the rear of the queue.
+ * @param s Size of the process, in the current request.
+ * @param d Duration of the process, in the current request.
+ */
+void enQueue(struct node **front, struct node **rear, int s, int d){
+    struct timeval arrival;
+    gettimeofday(&arrival, NULL);
+    enQueue_at(front, rear, s, d, arrival);
+}
+
 /**
  * Function to delete a request, from the front end of the queue.
  * @param front Double pointer to the front of the queue.
@@ -146,6 +171,7 @@ void sig_handler(int signum){
 
     printf("Memory utilization = %lf %%\n", memory_util_perc);
     printf("Average turn-around time = %lf sec\n", avg_turnaround_time);
+    PROF_REPORT();  /* Summary and timeline of the lock and wait behaviour, when built with -DPROFILE */
     log_msg("Program Terminated.", true);   /* Terminating the program by passing 'true' to the log_msg() function */
 
     pthread_mutex_unlock(&mutex);   /* Releasing the mutex lock */
@@ -156,22 +182,48 @@ void sig_handler(int signum){
  */
 void* process_execution_simulator(void *parameter){
     struct arguments *para = (struct arguments*)(parameter);
-    sleep(para->duration);  /* Sleep for the time duration of the process */
-    pthread_mutex_lock(&mutex); /* Acquiring the mutex lock */
+    pthread_detach(pthread_self()); /* Nobody joins this thread, so its resources are released as soon as it exits */
+    PROF_THREAD_START("simulator", PROF_EVENTS_SHORT_LIVED);
+
+    /* Sleep for the time duration of the process */
+    struct timespec exec_time;
+    exec_time.tv_sec = (para->duration * duration_unit_us) / 1000000;
+    exec_time.tv_nsec = ((para->duration * duration_unit_us) % 1000000) * 1000;
+    nanosleep(&exec_time, NULL);
+    PROF_LOCK(&mutex); /* Acquiring the mutex lock */
 
     /* Releasing the memory */
     for(int i = para->mem_start_idx; i < para->mem_start_idx + para->mem_size; i++){
         memory[i] = 0;
     }
-    printf("Process %d has released the memory\n", para->process_number);
+    if(verbose)
+        printf("Process %d has released the memory\n", para->process_number);
 
     pthread_cond_broadcast(&cond_memory); /* Broadcasting a signal to all the threads waiting on the cond_memory variable */
-    pthread_mutex_unlock(&mutex); /* Releasing the mutex lock */
+    PROF_UNLOCK(&mutex); /* Releasing the mutex lock */
     free(para);
+    PROF_THREAD_END();
     pthread_exit(NULL);
     return NULL;
 }
 
+/**
+ * Function to compute the range of the process size and duration, from the parameters m and t.
+ * @param l_limit_size Lower limit of the process size, a multiple of 10MB.
+ * @param u_limit_size Upper limit of the process size, a multiple of 10MB.
+ * @param l_limit_duration Lower limit of the process duration, a multiple of 5 units.
+ * @param u_limit_duration Upper limit of the process duration, a multiple of 5 units.
+ */
+void compute_request_limits(int *l_limit_size, int *u_limit_size, int *l_limit_duration, int *u_limit_duration){
+    /* This is to ensure that the process size is in between the given range and is a multiple of 10MB */
+    *l_limit_size = (int)(ceil((0.5 * m)/ 10) * 10);
+    *u_limit_size = (int)(floor((3.0 * m)/ 10) * 10);
+
+    /* This is to ensure that the process duration is in between the given range and is a multiple of 5 units */
+    *l_limit_duration = (int)(ceil((0.5 * t)/ 5) * 5);
+    *u_limit_duration = (int)(floor((6.0 * t)/ 5) * 5);
+}
+
 /**
  * Function to generate and add requests to the queue.
  * @param dummy This argument is just to ensure the compatability of the defined function with the expected signature.
@@ -179,28 +231,23 @@ void* process_execution_simulator(void *parameter){
 void* req_producer_thr(void * dummy){
     int s, d; /*Process size s and process duration d */
     int rhalt_sec, rhalt_nsec;
-    
+    PROF_THREAD_START("producer", PROF_EVENTS_LONG_LIVED);
+
     rhalt_sec = (int)(1/r);
     rhalt_nsec = (1/r - rhalt_sec) * 1000000000;
     struct timespec halt_time;
     halt_time.tv_sec = rhalt_sec;
     halt_time.tv_nsec = rhalt_nsec;
 
-    /* This is to ensure that the process size is in between the given range and is a multiple of 10MB */
     int l_limit_size, u_limit_size, l_limit_duration, u_limit_duration;
-    l_limit_size = (int)(ceil((0.5 * m)/ 10) * 10);
-    u_limit_size = (int)(floor((3.0 * m)/ 10) * 10);
-
-    /* This is to ensure that the process duration is in between the given range and is a multiple of 5 seconds */
-    l_limit_duration = (int)(ceil((0.5 * t)/ 5) * 5);
-    u_limit_duration = (int)(floor((6.0 * t)/ 5) * 5);
+    compute_request_limits(&l_limit_size, &u_limit_size, &l_limit_duration, &u_limit_duration);
     while(true){
         s = random_integer_interval(l_limit_size/10, u_limit_size/10) * 10;    /* Size in MB */
         d = random_integer_interval(l_limit_duration/5, u_limit_duration/5) * 5;    /* Duration in seconds */
-        pthread_mutex_lock(&mutex); /* Acquiring the mutex lock */
+        PROF_LOCK(&mutex); /* Acquiring the mutex lock */
         enQueue(&queue_front, &queue_rear, s, d);   /* Adding the request to the queue */
         pthread_cond_broadcast(&cond_queue);    /* Broadcasting a signal to all the threads waiting on the cond_queue variable */    
-        pthread_mutex_unlock(&mutex); /* Releasing the mutex lock */
+        PROF_UNLOCK(&mutex); /* Releasing the mutex lock */
         nanosleep(&halt_time, NULL);                   
     }
     return NULL;
@@ -215,6 +262,7 @@ void allocate_using_first_fit(){
     while(!canAllocate){
         int cur_available_mem = 0;
         int mem_start_idx = 0;
+        PROF_SCAN_BEGIN();
         for(int i = 0; i < num_memory_cells; i++){
             if(memory[i] == 0){ // Available memory
                 cur_available_mem += 1;
@@ -227,9 +275,11 @@ void allocate_using_first_fit(){
                 break; 
             }
         }
+        PROF_SCAN_END();
         if(canAllocate){
             
-            printf("Memory is allocated to process %d\n", queue_front->process_number);
+            if(verbose)
+                printf("Memory is allocated to process %d\n", queue_front->process_number);
             for(int i = mem_start_idx; i < mem_start_idx + mem_req; i++){
                 memory[i] = 1;  /* Marked the memory as allocated */
             }
@@ -242,6 +292,8 @@ void allocate_using_first_fit(){
             time_taken = (time_taken + (cur_time.tv_usec - (queue_front->arrival_time).tv_usec)) * 1e-6;
             total_turnaround_time += time_taken;
             total_allocated_processes += 1;
+            if(allocation_hook != NULL)
+                allocation_hook(time_taken);
  
             /*Create a thread which will simulate the process execution */
             pthread_t thr_id;
@@ -259,7 +311,7 @@ void allocate_using_first_fit(){
             }
             break;
         }else{
-            pthread_cond_wait(&cond_memory, &mutex); /* Waiting on the conditional variable cond_memory */
+            PROF_COND_WAIT(&cond_memory, &mutex, PROF_COND_MEMORY); /* Waiting on the conditional variable cond_memory */
         }
     }   
 }
@@ -274,6 +326,7 @@ void allocate_using_best_fit(){
         int cur_available_mem = 0;
         int mem_start_idx = 0;
         int final_mem_start_idx, final_cur_available_memory = INT_MAX;
+        PROF_SCAN_BEGIN();
         for(int i = 0; i < num_memory_cells; i++){
             if(memory[i] == 0){ /* Available memory */
                 cur_available_mem += 1;
@@ -296,8 +349,10 @@ void allocate_using_best_fit(){
                 final_mem_start_idx = mem_start_idx;
             }
         }
+        PROF_SCAN_END();
         if(canAllocate){
-            printf("Memory is allocated to process %d\n", queue_front->process_number);
+            if(verbose)
+                printf("Memory is allocated to process %d\n", queue_front->process_number);
             for(int i = final_mem_start_idx; i < final_mem_start_idx + mem_req; i++){
                 memory[i] = 1;  /* Marked the memory as allocated */
             } 
@@ -310,6 +365,8 @@ void allocate_using_best_fit(){
             time_taken = (time_taken + (cur_time.tv_usec - (queue_front->arrival_time).tv_usec)) * 1e-6;
             total_turnaround_time += time_taken;
             total_allocated_processes += 1;
+            if(allocation_hook != NULL)
+                allocation_hook(time_taken);
 
             for(int i = final_mem_start_idx; i < final_mem_start_idx + mem_req; i++){
                 memory[i] = 1;  /* Marked the memory as allocated */
@@ -328,7 +385,7 @@ void allocate_using_best_fit(){
             }
             break;
         }else{
-            pthread_cond_wait(&cond_memory, &mutex);
+            PROF_COND_WAIT(&cond_memory, &mutex, PROF_COND_MEMORY);
         }
     }
 }
@@ -342,6 +399,7 @@ void allocate_using_next_fit(){
     while(!canAllocate){
         int cur_available_mem = 0;
         int mem_start_idx = next_idx_of_last_allocated;
+        PROF_SCAN_BEGIN();
         for(int i = next_idx_of_last_allocated; i < num_memory_cells; i++){
             if(memory[i] == 0){ /* Available memory */
                 cur_available_mem += 1;
@@ -371,9 +429,11 @@ void allocate_using_next_fit(){
                 }
             }
         }
+        PROF_SCAN_END();
 
         if(canAllocate){
-            printf("Memory is allocated to process %d\n", queue_front->process_number);
+            if(verbose)
+                printf("Memory is allocated to process %d\n", queue_front->process_number);
             for(int i = mem_start_idx; i < mem_start_idx + mem_req; i++){
                 memory[i] = 1;  /* Marked the memory as allocated */
             }   
@@ -386,6 +446,8 @@ void allocate_using_next_fit(){
             time_taken = (time_taken + (cur_time.tv_usec - (queue_front->arrival_time).tv_usec)) * 1e-6;
             total_turnaround_time += time_taken;
             total_allocated_processes += 1;
+            if(allocation_hook != NULL)
+                allocation_hook(time_taken);
  
             /*Create a thread which will simulate the process execution */
             pthread_t thr_id;
@@ -402,7 +464,7 @@ void allocate_using_next_fit(){
             }
             break;
         }else{
-            pthread_cond_wait(&cond_memory, &mutex);
+            PROF_COND_WAIT(&cond_memory, &mutex, PROF_COND_MEMORY);
         }
     } 
 }
@@ -425,14 +487,15 @@ void perform_allocation(){
  * @param dummy This argument is just to ensure the compatability of the defined function with the expected signature.
  */
 void* memory_allocator_thr(void *dummy){
+    PROF_THREAD_START("allocator", PROF_EVENTS_LONG_LIVED);
     while(true){
-        pthread_mutex_lock(&mutex); /* Acquiring the mutex lock */
+        PROF_LOCK(&mutex); /* Acquiring the mutex lock */
         while (queue_front == NULL && queue_rear == NULL){
             /* If true, then we wait on the conditional variable cond */
-            pthread_cond_wait(&cond_queue, &mutex);
+            PROF_COND_WAIT(&cond_queue, &mutex, PROF_COND_QUEUE);
         }
         perform_allocation();
-        pthread_mutex_unlock(&mutex); /* Releasing the mutex lock */
+        PROF_UNLOCK(&mutex); /* Releasing the mutex lock */
     }
 }
 
@@ -0,0 +1,432 @@
+#include <string.h>
+#include <time.h>
+
+/*
+ * Load generation mode, which drives the allocator with several producer threads in order to find
+ * the highest request rate each placement algorithm can sustain. It must be included after all_functions.h.
+ * In this mode the process durations are in milliseconds and the per-request logging is disabled.
+ */
+
+#define LOAD_OPEN_LOOP 1    /* Requests are issued at a target rate, regardless of how fast they are served */
+#define LOAD_CLOSED_LOOP 2  /* A fixed number of requests is kept waiting for memory at all times */
+
+#define LOAD_HIST_BUCKETS 512
+#define LOAD_SUSTAINED_FRACTION 0.95    /* Fraction of the target rate which must be allocated during a step */
+#define LOAD_DEFAULT_SLO_MS 100.0   /* Default bound on the 99th percentile turnaround time of a sustained step */
+#define LOAD_REFINE_STEPS 4 /* Bisection steps between the highest sustained and the lowest failed rate */
+#define LOAD_MAX_RATE 1e7   /* The open-loop sweep stops doubling the rate beyond this */
+#define LOAD_PROF_EVENTS (1 << 14)  /* Trace buffer size for the load producer threads */
+
+/*Structure to store the outcome of a single measurement step */
+struct load_result{
+    double target_rate;     /* Requests/sec asked for (open-loop only) */
+    double offered_rate;    /* Requests/sec actually added to the queue before the end of the step */
+    double max_lag_ms;      /* Longest delay of a producer behind its schedule (open-loop only) */
+    double achieved_rate;   /* Requests/sec allocated memory, between the start of the step and the last allocation */
+    double p50_ms, p99_ms, p999_ms, max_ms; /* Turnaround time percentiles */
+    bool sustained;
+};
+
+const char *load_algo_names[] = {"", "First-fit", "Best-fit", "Next-fit"};
+
+int load_threads;   /* Number of producer threads */
+int load_mode;      /* LOAD_OPEN_LOOP or LOAD_CLOSED_LOOP */
+double load_rate;   /* Initial target rate of the open-loop sweep, in requests/sec */
+int load_outstanding;   /* Number of requests kept in the queue, in the closed-loop mode */
+int load_step_sec;  /* Duration of each measurement step, in seconds */
+double load_slo_ms = LOAD_DEFAULT_SLO_MS;
+
+/* State of the current step, protected by the mutex */
+bool load_running = false;
+double load_target_rate;
+struct timeval load_start_time, load_end_time;
+long long load_offered = 0;     /* Requests added to the queue before the end of the step */
+double load_max_lag = 0;        /* Longest delay between the due time of a request and its addition, in seconds */
+long long load_allocated = 0;   /* Requests of the step which have been allocated memory */
+struct timeval load_last_allocation;    /* Time at which the last request of the step was allocated memory */
+int load_in_flight = 0;         /* Requests added to the queue, but not yet allocated memory */
+unsigned long long load_hist[LOAD_HIST_BUCKETS];    /* Histogram of the turnaround times, in microseconds */
+unsigned long long load_hist_total, load_hist_max;
+
+pthread_cond_t cond_load;   /* Conditional Variable, signalled when a closed-loop request is allocated memory */
+
+/* Add a number of seconds to a timeval */
+struct timeval timeval_add(struct timeval tv, double sec){
+    long long usec = (long long)tv.tv_sec * 1000000 + tv.tv_usec + (long long)(sec * 1e6);
+    tv.tv_sec = usec / 1000000;
+    tv.tv_usec = usec % 1000000;
+    return tv;
+}
+
+/* Difference b - a between two timevals, in seconds */
+double timeval_diff(struct timeval a, struct timeval b){
+    return (b.tv_sec - a.tv_sec) + (b.tv_usec - a.tv_usec) * 1e-6;
+}
+
+/**
+ * Function to map a value to its histogram bucket. Values below 16 get a bucket each, larger values
+ * share a bucket with those having the same 4 leading bits, which bounds the relative error to 12.5%.
+ */
+int load_hist_index(unsigned long long v){
+    if(v < 16)
+        return (int)v;
+    int shift = (63 - __builtin_clzll(v)) - 3;
+    return 8 * shift + (int)(v >> shift);
+}
+
+/* Largest value which maps to the given histogram bucket */
+unsigned long long load_hist_upper(int idx){
+    if(idx < 16)
+        return idx;
+    int shift = idx / 8 - 1;
+    unsigned long long top = idx % 8 + 8;
+    return ((top + 1) << shift) - 1;
+}
+
+/* Turnaround time at the given quantile of the histogram, in milliseconds */
+double load_hist_quantile(double quantile){
+    if(load_hist_total == 0)
+        return 0;
+    unsigned long long rank = (unsigned long long)ceil(quantile * load_hist_total);
+    unsigned long long seen = 0;
+    for(int i = 0; i < LOAD_HIST_BUCKETS; i++){
+        seen += load_hist[i];
+        if(seen >= rank && seen > 0){
+            unsigned long long v = load_hist_upper(i);
+            return (v < load_hist_max ? v : load_hist_max) * 1e-3;
+        }
+    }
+    return load_hist_max * 1e-3;
+}
+
+/**
+ * Function which is installed as the allocation_hook, to record the turnaround time of every request.
+ * It is called by the allocators with the mutex held.
+ * @param time_taken Time between the arrival of the request and the allocation of memory to it, in seconds.
+ */
+void load_record_allocation(double time_taken){
+    unsigned long long usec = time_taken > 0 ? (unsigned long long)(time_taken * 1e6) : 0;
+    load_hist[load_hist_index(usec)] += 1;
+    load_hist_total += 1;
+    if(usec > load_hist_max)
+        load_hist_max = usec;
+    load_allocated += 1;
+    gettimeofday(&load_last_allocation, NULL);
+    load_in_flight -= 1;
+    if(load_mode == LOAD_CLOSED_LOOP)
+        pthread_cond_signal(&cond_load);    /* A single slot in the closed-loop window is free, so one producer is enough */
+}
+
+/**
+ * Function executed by each of the load producer threads.
+ * In the open-loop mode, the k-th request of thread i is due at (k * load_threads + i) / rate seconds after the start
+ * of the step, and its turnaround time is measured from that due time rather than from when it was actually added.
+ * A producer which falls behind the schedule therefore still accounts for the delay (coordinated omission), and
+ * it keeps going after the step has ended until every request due within the step has been added.
+ * In the closed-loop mode, the producers add a request whenever fewer than load_outstanding are waiting.
+ * @param parameter Index of the producer thread.
+ */
+void* load_producer_thr(void *parameter){
+    int id = (int)(long)parameter;
+    unsigned int seed = (unsigned int)(id + 1) * 2654435761u ^ (unsigned int)load_start_time.tv_usec;
+    int l_limit_size, u_limit_size, l_limit_duration, u_limit_duration;
+    compute_request_limits(&l_limit_size, &u_limit_size, &l_limit_duration, &u_limit_duration);
+    PROF_THREAD_START("loadgen", LOAD_PROF_EVENTS);
+
+    for(long long k = 0; ; k++){
+        int s = random_integer_interval_r(&seed, l_limit_size/10, u_limit_size/10) * 10;    /* Size in MB */
+        int d = random_integer_interval_r(&seed, l_limit_duration/5, u_limit_duration/5) * 5;    /* Duration in milliseconds */
+        struct timeval arrival;
+
+        if(load_mode == LOAD_OPEN_LOOP){
+            arrival = timeval_add(load_start_time, (k * load_threads + id) / load_target_rate);
+            if(timeval_diff(arrival, load_end_time) <= 0)
+                break;  /* The next request is due after the end of the step */
+            struct timespec due_time;
+            due_time.tv_sec = arrival.tv_sec;
+            due_time.tv_nsec = arrival.tv_usec * 1000;
+            clock_nanosleep(CLOCK_REALTIME, TIMER_ABSTIME, &due_time, NULL);
+        }
+
+        PROF_LOCK(&mutex); /* Acquiring the mutex lock */
+        while(load_mode == LOAD_CLOSED_LOOP && load_running && load_in_flight >= load_outstanding){
+            PROF_COND_WAIT(&cond_load, &mutex, PROF_COND_LOAD);
+        }
+        if(load_mode == LOAD_CLOSED_LOOP && !load_running){
+            PROF_UNLOCK(&mutex);
+            break;
+        }
+        struct timeval now;
+        gettimeofday(&now, NULL);
+        if(load_mode == LOAD_CLOSED_LOOP)
+            arrival = now;
+        enQueue_at(&queue_front, &queue_rear, s, d, arrival);   /* Adding the request to the queue */
+
+        /* A request added late counts towards the lag, and only the ones added within the step are offered */
+        if(timeval_diff(arrival, now) > load_max_lag)
+            load_max_lag = timeval_diff(arrival, now);
+        if(load_mode == LOAD_CLOSED_LOOP || timeval_diff(now, load_end_time) > 0)
+            load_offered += 1;
+        load_in_flight += 1;
+        pthread_cond_broadcast(&cond_queue);    /* Broadcasting a signal to all the threads waiting on the cond_queue variable */
+        PROF_UNLOCK(&mutex); /* Releasing the mutex lock */
+    }
+    PROF_THREAD_END();
+    return NULL;
+}
+
+/**
+ * Function to run a single measurement step of load_step_sec seconds, and wait until all of its requests
+ * have been allocated and have released their memory, so that the next step starts from an empty memory.
+ * @param target_rate Requests/sec to be issued in the open-loop mode. Ignored in the closed-loop mode.
+ */
+struct load_result run_load_step(double target_rate){
+    struct load_result res;
+    pthread_t *thr_ids = (pthread_t*)malloc(sizeof(pthread_t) * load_threads);
+    struct timeval stop_time;
+
+    PROF_LOCK(&mutex);
+    memset(load_hist, 0, sizeof(load_hist));
+    load_hist_total = 0;
+    load_hist_max = 0;
+    load_offered = 0;
+    load_max_lag = 0;
+    load_allocated = 0;
+    load_target_rate = target_rate;
+    gettimeofday(&load_start_time, NULL);
+    load_last_allocation = load_start_time;
+    load_end_time = timeval_add(load_start_time, load_step_sec);
+    load_running = true;
+    PROF_UNLOCK(&mutex);
+
+    for(int i = 0; i < load_threads; i++){
+        int rc = pthread_create(&thr_ids[i], NULL, load_producer_thr, (void *)(long)i);
+        if (rc) {
+            log_msg("Failed to create the load producer thread.", true);
+        }
+    }
+    sleep(load_step_sec);
+
+    PROF_LOCK(&mutex);
+    load_running = false;
+    gettimeofday(&stop_time, NULL);
+    pthread_cond_broadcast(&cond_load); /* Release the closed-loop producers */
+    PROF_UNLOCK(&mutex);
+
+    /* The open-loop producers stop by themselves, once all the requests due within the step have been added */
+    for(int i = 0; i < load_threads; i++)
+        pthread_join(thr_ids[i], NULL);
+    free(thr_ids);
+
+    PROF_LOCK(&mutex);
+    double elapsed = (load_mode == LOAD_OPEN_LOOP) ? load_step_sec : timeval_diff(load_start_time, stop_time);
+    res.target_rate = target_rate;
+    res.offered_rate = load_offered / elapsed;
+    res.max_lag_ms = load_max_lag * 1e3;
+    PROF_UNLOCK(&mutex);
+
+    /* Drain the queue and wait for all the processes of this step to release their memory */
+    struct timespec poll_time = {0, 10000000};
+    while(true){
+        PROF_LOCK(&mutex);
+        bool busy = (queue_front != NULL);
+        for(int i = 0; i < num_memory_cells && !busy; i++){
+            if(memory[i] == 1)
+                busy = true;
+        }
+        if(!busy){
+            /*
+             * Every request of the step has been allocated by now, including those added near its end. They are
+             * divided by the time the allocations actually took, so that a backlog lowers the achieved rate.
+             */
+            double span = timeval_diff(load_start_time, load_last_allocation);
+            res.achieved_rate = (span > elapsed) ? load_allocated / span : load_allocated / elapsed;
+            res.p50_ms = load_hist_quantile(0.5);
+            res.p99_ms = load_hist_quantile(0.99);
+            res.p999_ms = load_hist_quantile(0.999);
+            res.max_ms = load_hist_max * 1e-3;
+        }
+        PROF_UNLOCK(&mutex);
+        if(!busy)
+            break;
+        nanosleep(&poll_time, NULL);
+    }
+
+    res.sustained = (res.p99_ms <= load_slo_ms);
+    if(load_mode == LOAD_OPEN_LOOP)
+        res.sustained = res.sustained && (res.achieved_rate >= LOAD_SUSTAINED_FRACTION * target_rate);
+    return res;
+}
+
+void print_load_result(int algo, struct load_result res){
+    char target[32] = "-", lag[32] = "-";  /* The closed-loop mode has no target rate nor schedule */
+    if(load_mode == LOAD_OPEN_LOOP){
+        snprintf(target, sizeof(target), "%.1lf", res.target_rate);
+        snprintf(lag, sizeof(lag), "%.3lf", res.max_lag_ms);
+    }
+    printf("%-10s %14s %14.1lf %12s %15.1lf %10.3lf %10.3lf %10.3lf %10.3lf %10s\n",
+           load_algo_names[algo], target, res.offered_rate, lag, res.achieved_rate,
+           res.p50_ms, res.p99_ms, res.p999_ms, res.max_ms, res.sustained ? "yes" : "no");
+}
+
+/**
+ * Function to find the maximum sustainable rate of a placement algorithm. In the open-loop mode, the target rate
+ * is doubled until a step fails, and the boundary is then refined by bisection. In the closed-loop mode, a single
+ * step is run and the achieved rate is the maximum at that number of outstanding requests.
+ * @param algo The placement algorithm to be measured.
+ * @param best Set to the result of the step with the highest sustained rate.
+ * @return false if no step was sustained.
+ */
+bool measure_algorithm(int algo, struct load_result *best){
+    bool found = false;
+
+    PROF_LOCK(&mutex);
+    algo_choice = algo;
+    next_idx_of_last_allocated = 0;
+    PROF_UNLOCK(&mutex);
+
+    if(load_mode == LOAD_CLOSED_LOOP){
+        *best = run_load_step(0);
+        print_load_result(algo, *best);
+        return best->sustained;
+    }
+
+    double low = 0, high = 0;   /* Highest sustained and lowest failed rate */
+    for(double rate = load_rate; rate <= LOAD_MAX_RATE; rate *= 2){
+        struct load_result res = run_load_step(rate);
+        print_load_result(algo, res);
+        if(!res.sustained){
+            high = rate;
+            break;
+        }
+        low = rate;
+        *best = res;
+        found = true;
+    }
+    for(int i = 0; i < LOAD_REFINE_STEPS && high > 0; i++){
+        double rate = (low + high) / 2;
+        struct load_result res = run_load_step(rate);
+        print_load_result(algo, res);
+        if(res.sustained){
+            low = rate;
+            *best = res;
+            found = true;
+        }else{
+            high = rate;
+        }
+    }
+    return found;
+}
+
+void print_load_usage(const char *prog){
+    printf("Usage: %s --load p q m t choice N mode X S [slo]\n", prog);
+    printf("where, \n");
+    printf("p = Total physical memory(in MB) in the simulation.\n");
+    printf("q = Memory(in MB) reserved for the operating system.\n");
+    printf("m = Parameter to determine the size of the process in a request.\n");
+    printf("t = Parameter to determine the duration(in milliseconds) of the process in a request.\n");
+    printf("choice = 0 to measure all the memory placement algorithms, or 1, 2 or 3 for a single one.\n");
+    printf("N = Number of producer threads.\n");
+    printf("mode = open or closed.\n");
+    printf("X = Initial target rate(requests/sec) for open, or number of outstanding requests for closed.\n");
+    printf("S = Duration(in seconds) of each measurement step.\n");
+    printf("slo = Bound(in ms) on the 99th percentile turnaround time of a sustained step. Default %.0lf.\n", LOAD_DEFAULT_SLO_MS);
+}
+
+/**
+ * Entry point of the load generation mode, invoked by main() when the first argument is --load.
+ */
+int load_main(int argc, char *argv[]){
+    if (argc != 11 && argc != 12) {
+        print_load_usage(argv[0]);
+        exit(-1);
+    }
+
+    p = atoi(argv[2]);
+    q = atoi(argv[3]);
+    m = atoi(argv[4]);
+    t = atoi(argv[5]);
+    algo_choice = atoi(argv[6]);
+    load_threads = atoi(argv[7]);
+    if(strcmp(argv[8], "open") == 0){
+        load_mode = LOAD_OPEN_LOOP;
+        load_rate = atof(argv[9]);
+    }else if(strcmp(argv[8], "closed") == 0){
+        load_mode = LOAD_CLOSED_LOOP;
+        load_outstanding = atoi(argv[9]);
+    }else{
+        log_msg("mode must be either open or closed.", true);
+    }
+    load_step_sec = atoi(argv[10]);
+    if(argc == 12)
+        load_slo_ms = atof(argv[11]);
+
+    num_memory_cells = ((p - q)/10);    /* 1 memory cell represents 10MB of memory */
+    int l_limit_size, u_limit_size, l_limit_duration, u_limit_duration;
+    compute_request_limits(&l_limit_size, &u_limit_size, &l_limit_duration, &u_limit_duration);
+    if(algo_choice < 0 || algo_choice > 3)
+        log_msg("choice must be 0, 1, 2 or 3.", true);
+    if(load_threads < 1 || load_step_sec < 1)
+        log_msg("N and S must be at least 1.", true);
+    if((load_mode == LOAD_OPEN_LOOP && load_rate <= 0) || (load_mode == LOAD_CLOSED_LOOP && load_outstanding < 1))
+        log_msg("X must be positive.", true);
+    if(u_limit_size <= l_limit_size || u_limit_duration <= l_limit_duration)
+        log_msg("m and t are too small to give a range of process sizes and durations.", true);
+    if(u_limit_size/10 > num_memory_cells)
+        log_msg("The largest process does not fit in the memory available.", true);
+
+    memory = (int *) malloc(sizeof(int) * num_memory_cells);
+    for(int i = 0; i < num_memory_cells; i++)
+        memory[i] = 0;
+    verbose = false;
+    duration_unit_us = 1000;    /* Process durations are in milliseconds */
+    allocation_hook = load_record_allocation;
+
+    printf("=====================Load generation=====================\n");
+    printf("Parameters for load generation :: \n");
+    printf("p = %d\n", p);
+    printf("q = %d\n", q);
+    printf("m = %d\n", m);
+    printf("t = %d ms\n", t);
+    printf("N = %d\n", load_threads);
+    if(load_mode == LOAD_OPEN_LOOP)
+        printf("mode = open-loop, starting at %.1lf requests/sec\n", load_rate);
+    else
+        printf("mode = closed-loop, %d outstanding requests\n", load_outstanding);
+    printf("S = %d sec\n", load_step_sec);
+    printf("slo = %.1lf ms\n", load_slo_ms);
+    printf("\n");
+
+    PROF_INIT();
+    PROF_THREAD_START("loadctl", LOAD_PROF_EVENTS);
+    pthread_mutex_init(&mutex, NULL);   // Initializing the mutex
+    pthread_cond_init(&cond_queue, NULL);   // Initializing the conditional variable
+    pthread_cond_init(&cond_memory, NULL);   // Initializing the conditional variable
+    pthread_cond_init(&cond_load, NULL);   // Initializing the conditional variable
+    signal(SIGINT,sig_handler); // Register signal handler for SIGINT
+
+    int rc = pthread_create(&ma_thr_id, NULL, memory_allocator_thr , NULL);
+    if (rc) {
+        log_msg("Failed to create the memory allocator thread.", true);
+    }
+
+    int first_algo = (algo_choice == 0) ? 1 : algo_choice;
+    int last_algo = (algo_choice == 0) ? 3 : algo_choice;
+    struct load_result best[4];
+    bool found[4];
+    printf("%-10s %14s %14s %12s %15s %10s %10s %10s %10s %10s\n", "algorithm", "target(req/s)", "offered(req/s)", "max lag(ms)",
+           "achieved(req/s)", "p50(ms)", "p99(ms)", "p99.9(ms)", "max(ms)", "sustained");
+    for(int algo = first_algo; algo <= last_algo; algo++){
+        found[algo] = measure_algorithm(algo, &best[algo]);
+    }
+
+    printf("\n=====================Maximum sustainable rate=====================\n");
+    for(int algo = first_algo; algo <= last_algo; algo++){
+        if(found[algo])
+            printf("%-10s %.1lf requests/sec (p99 turnaround = %.3lf ms)\n", load_algo_names[algo], best[algo].achieved_rate, best[algo].p99_ms);
+        else
+            printf("%-10s no rate was sustained\n", load_algo_names[algo]);
+    }
+    PROF_REPORT();
+    return 0;
+}
@@ -1,6 +1,9 @@
 #include "all_functions.h" 
+#include "load_generator.h"
 
 int main(int argc, char *argv[]) {
+    if (argc > 1 && strcmp(argv[1], "--load") == 0)
+        return load_main(argc, argv);   /* Load generation mode */
     if (argc != 8) {
         printf("Usage: %s p q n m t T choice\n",argv[0]);
         printf("where, \n");
@@ -42,6 +45,7 @@ int main(int argc, char *argv[]) {
     printf("r = %lf\n", r);
     printf("\n");
 
+    PROF_INIT();    /* Start of the profiling timeline, when built with -DPROFILE */
     pthread_mutex_init(&mutex, NULL);   // Initializing the mutex
     pthread_cond_init(&cond_queue, NULL);   // Initializing the conditional variable
     pthread_cond_init(&cond_memory, NULL);   // Initializing the conditional variable
@@ -0,0 +1,416 @@
+#include <stdio.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+/*
+ * Instrumentation of the allocator's lock and wait behaviour. It is compiled in only when the
+ * program is built with -DPROFILE; otherwise every PROF_* macro reduces to the plain pthread
+ * call (or to nothing), so the default build pays no cost.
+ */
+
+/* Conditional variables which are tracked separately by the profiler */
+enum prof_cond_kind{
+    PROF_COND_QUEUE,
+    PROF_COND_MEMORY,
+    PROF_COND_LOAD,
+    PROF_NUM_CONDS
+};
+
+#define PROF_EVENTS_LONG_LIVED (1 << 18)   /* Trace buffer size for the producer and allocator threads */
+#define PROF_EVENTS_SHORT_LIVED 16   /* Trace buffer size for the process simulator threads */
+
+#ifdef PROFILE
+
+#ifndef PROF_MAX_THREADS
+#define PROF_MAX_THREADS 8192   /* Threads beyond this count have no timeline, and are folded into prof_overflow when they exit */
+#endif
+#define PROF_MAX_ROWS 16    /* Maximum number of distinct thread names in the summary table */
+
+enum prof_event_kind{
+    PROF_EV_LOCK_WAIT,
+    PROF_EV_LOCK_HOLD,
+    PROF_EV_SCAN,
+    PROF_EV_WAIT_QUEUE,
+    PROF_EV_WAIT_MEMORY,
+    PROF_EV_WAIT_LOAD,
+    PROF_EV_SPURIOUS_QUEUE,
+    PROF_EV_SPURIOUS_MEMORY,
+    PROF_EV_SPURIOUS_LOAD
+};
+
+const char *prof_event_names[] = {
+    "lock wait", "lock hold", "placement scan", "wait cond_queue", "wait cond_memory", "wait cond_load",
+    "spurious wakeup cond_queue", "spurious wakeup cond_memory", "spurious wakeup cond_load"
+};
+
+const char *prof_cond_names[] = {"queue", "memory", "load"};
+
+/*Structure to store a single interval of the timeline */
+struct prof_event{
+    uint64_t start_ns;
+    uint64_t dur_ns;
+    int kind;
+};
+
+/*Structure to store the counters and the timeline of a single thread */
+struct prof_thread{
+    const char *name;
+    int tid;
+    uint64_t lock_acquires;
+    uint64_t lock_wait_ns;
+    uint64_t max_lock_wait_ns;
+    uint64_t lock_hold_ns;
+    uint64_t hold_start_ns;
+    uint64_t scans;
+    uint64_t scan_ns;
+    uint64_t scan_start_ns;
+    uint64_t cond_waits[PROF_NUM_CONDS];
+    uint64_t cond_wait_ns[PROF_NUM_CONDS];
+    uint64_t spurious_wakeups[PROF_NUM_CONDS];
+    bool pending_wakeup[PROF_NUM_CONDS];   /* Woken up on this variable during the current lock hold */
+    struct prof_event *events;
+    int max_events;
+    int num_events;
+    uint64_t dropped_events;
+};
+
+struct prof_thread *prof_threads[PROF_MAX_THREADS];  /* Registry of all the profiled threads */
+int prof_num_threads = 0;
+
+/* Counters of the exited threads which did not fit in the registry, aggregated by name */
+struct prof_thread prof_overflow[PROF_MAX_ROWS];
+uint64_t prof_overflow_threads[PROF_MAX_ROWS];
+uint64_t prof_num_folded = 0;
+uint64_t prof_epoch_ns = 0;  /* Time at which the profiling started */
+__thread struct prof_thread *prof_self = NULL;   /* Record of the calling thread */
+
+/* Current value of the monotonic clock, in nanoseconds */
+uint64_t prof_now_ns(){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+void prof_init(){
+    prof_epoch_ns = prof_now_ns();
+}
+
+/**
+ * Function to create the profiling record of the calling thread.
+ * The registry is updated without a lock, so that it is safe to read it from the signal handler.
+ * @param name Name under which the thread is reported. Threads with the same name are aggregated in the summary.
+ * @param max_events Number of timeline events which are kept for this thread.
+ */
+void prof_thread_register(const char *name, int max_events){
+    struct prof_thread *th = (struct prof_thread*)calloc(1, sizeof(struct prof_thread));
+    if(th == NULL)
+        return;
+    th->name = name;
+    int idx = __atomic_fetch_add(&prof_num_threads, 1, __ATOMIC_RELAXED);
+    th->tid = idx + 1;
+    if(idx < PROF_MAX_THREADS){
+        th->events = (struct prof_event*)malloc(sizeof(struct prof_event) * max_events);
+        th->max_events = (th->events == NULL) ? 0 : max_events;
+        __atomic_store_n(&prof_threads[idx], th, __ATOMIC_RELEASE);
+    }
+    prof_self = th;
+}
+
+/* Atomically raise *dst to at least v */
+void prof_atomic_max(uint64_t *dst, uint64_t v){
+    uint64_t cur = __atomic_load_n(dst, __ATOMIC_RELAXED);
+    while(v > cur && !__atomic_compare_exchange_n(dst, &cur, v, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+        ;
+}
+
+/**
+ * Function to be called by a profiled thread just before it exits. The records in the registry are kept for the
+ * report, while a record which did not fit in the registry is added to the overflow row of its name and freed.
+ * The overflow rows are updated without a lock, so that it is safe to read them from the signal handler.
+ */
+void prof_thread_end(){
+    struct prof_thread *th = prof_self;
+    if(th == NULL)
+        return;
+    prof_self = NULL;
+    if(th->tid <= PROF_MAX_THREADS)
+        return;
+
+    int j = 0;
+    while(j < PROF_MAX_ROWS){
+        const char *expected = NULL;
+        if(__atomic_compare_exchange_n(&prof_overflow[j].name, &expected, th->name, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)
+           || strcmp(expected, th->name) == 0)
+            break;
+        j++;
+    }
+    if(j < PROF_MAX_ROWS){
+        struct prof_thread *row = &prof_overflow[j];
+        __atomic_fetch_add(&row->lock_acquires, th->lock_acquires, __ATOMIC_RELAXED);
+        __atomic_fetch_add(&row->lock_wait_ns, th->lock_wait_ns, __ATOMIC_RELAXED);
+        prof_atomic_max(&row->max_lock_wait_ns, th->max_lock_wait_ns);
+        __atomic_fetch_add(&row->lock_hold_ns, th->lock_hold_ns, __ATOMIC_RELAXED);
+        __atomic_fetch_add(&row->scans, th->scans, __ATOMIC_RELAXED);
+        __atomic_fetch_add(&row->scan_ns, th->scan_ns, __ATOMIC_RELAXED);
+        for(int k = 0; k < PROF_NUM_CONDS; k++){
+            __atomic_fetch_add(&row->cond_waits[k], th->cond_waits[k], __ATOMIC_RELAXED);
+            __atomic_fetch_add(&row->cond_wait_ns[k], th->cond_wait_ns[k], __ATOMIC_RELAXED);
+            __atomic_fetch_add(&row->spurious_wakeups[k], th->spurious_wakeups[k], __ATOMIC_RELAXED);
+        }
+        __atomic_fetch_add(&prof_overflow_threads[j], 1, __ATOMIC_RELEASE);
+        __atomic_fetch_add(&prof_num_folded, 1, __ATOMIC_RELEASE);
+    }
+    free(th);
+}
+
+/* Record of the calling thread, registering it on first use if it was not named explicitly */
+struct prof_thread* prof_get(){
+    if(prof_self == NULL)
+        prof_thread_register("main", PROF_EVENTS_LONG_LIVED);
+    return prof_self;
+}
+
+/* Append an interval to the timeline of the thread, dropping it if the buffer is full */
+void prof_record(struct prof_thread *th, int kind, uint64_t start_ns, uint64_t dur_ns){
+    if(th->num_events >= th->max_events){
+        th->dropped_events += 1;
+        return;
+    }
+    struct prof_event *ev = &(th->events[th->num_events]);
+    ev->start_ns = start_ns;
+    ev->dur_ns = dur_ns;
+    ev->kind = kind;
+    __atomic_store_n(&(th->num_events), th->num_events + 1, __ATOMIC_RELEASE);
+}
+
+/* Close the lock hold interval which started at hold_start_ns */
+void prof_end_hold(struct prof_thread *th, uint64_t now){
+    th->lock_hold_ns += now - th->hold_start_ns;
+    prof_record(th, PROF_EV_LOCK_HOLD, th->hold_start_ns, now - th->hold_start_ns);
+}
+
+void prof_mutex_lock(pthread_mutex_t *mtx){
+    struct prof_thread *th = prof_get();
+    uint64_t t0 = prof_now_ns();
+    pthread_mutex_lock(mtx);
+    uint64_t t1 = prof_now_ns();
+    th->lock_acquires += 1;
+    th->lock_wait_ns += t1 - t0;
+    if(t1 - t0 > th->max_lock_wait_ns)
+        th->max_lock_wait_ns = t1 - t0;
+    prof_record(th, PROF_EV_LOCK_WAIT, t0, t1 - t0);
+    th->hold_start_ns = t1;
+}
+
+void prof_mutex_unlock(pthread_mutex_t *mtx){
+    struct prof_thread *th = prof_get();
+    prof_end_hold(th, prof_now_ns());
+    for(int i = 0; i < PROF_NUM_CONDS; i++)
+        th->pending_wakeup[i] = false;
+    pthread_mutex_unlock(mtx);
+}
+
+/**
+ * Function to wait on a conditional variable, while accounting the time blocked on it.
+ * The mutex is not held while waiting, so the current lock hold interval is closed before the wait.
+ * A wakeup is counted as spurious if the thread has to wait again on the same variable without
+ * releasing the mutex in between, i.e. the condition it was waiting for still did not hold.
+ * @param cond Conditional variable to wait on.
+ * @param mtx Mutex associated with the conditional variable.
+ * @param kind Which of the tracked conditional variables is being waited on.
+ */
+void prof_cond_wait(pthread_cond_t *cond, pthread_mutex_t *mtx, int kind){
+    struct prof_thread *th = prof_get();
+    uint64_t t0 = prof_now_ns();
+    prof_end_hold(th, t0);
+    if(th->pending_wakeup[kind]){
+        th->spurious_wakeups[kind] += 1;
+        prof_record(th, PROF_EV_SPURIOUS_QUEUE + kind, t0, 0);
+    }
+    pthread_cond_wait(cond, mtx);
+    uint64_t t1 = prof_now_ns();
+    th->cond_waits[kind] += 1;
+    th->cond_wait_ns[kind] += t1 - t0;
+    prof_record(th, PROF_EV_WAIT_QUEUE + kind, t0, t1 - t0);
+    th->pending_wakeup[kind] = true;
+    th->hold_start_ns = t1;
+}
+
+void prof_scan_begin(){
+    prof_get()->scan_start_ns = prof_now_ns();
+}
+
+void prof_scan_end(){
+    struct prof_thread *th = prof_get();
+    uint64_t now = prof_now_ns();
+    th->scans += 1;
+    th->scan_ns += now - th->scan_start_ns;
+    prof_record(th, PROF_EV_SCAN, th->scan_start_ns, now - th->scan_start_ns);
+}
+
+/**
+ * Function to add the counters of a thread, or of an overflow row, to the summary row with the same name.
+ * @param rows Rows of the summary table.
+ * @param num_threads Number of threads aggregated in each row.
+ * @param num_rows Number of rows in use, updated if a new row is started.
+ * @param th Counters to be added.
+ * @param threads Number of threads which th stands for.
+ */
+void prof_add_to_row(struct prof_thread *rows, uint64_t *num_threads, int *num_rows, struct prof_thread *th, uint64_t threads){
+    int j = 0;
+    while(j < *num_rows && strcmp(rows[j].name, th->name) != 0)
+        j++;
+    if(j == *num_rows){
+        if(*num_rows == PROF_MAX_ROWS)
+            return;
+        memset(&rows[j], 0, sizeof(struct prof_thread));
+        rows[j].name = th->name;
+        num_threads[j] = 0;
+        *num_rows += 1;
+    }
+    struct prof_thread *row = &rows[j];
+    num_threads[j] += threads;
+    row->lock_acquires += th->lock_acquires;
+    row->lock_wait_ns += th->lock_wait_ns;
+    if(th->max_lock_wait_ns > row->max_lock_wait_ns)
+        row->max_lock_wait_ns = th->max_lock_wait_ns;
+    row->lock_hold_ns += th->lock_hold_ns;
+    row->scans += th->scans;
+    row->scan_ns += th->scan_ns;
+    for(int k = 0; k < PROF_NUM_CONDS; k++){
+        row->cond_waits[k] += th->cond_waits[k];
+        row->cond_wait_ns[k] += th->cond_wait_ns[k];
+        row->spurious_wakeups[k] += th->spurious_wakeups[k];
+    }
+    row->dropped_events += th->dropped_events;
+}
+
+/**
+ * Function to print the per-thread summary table. Threads with the same name are aggregated into one row.
+ * @param out Stream to which the table is written.
+ */
+void prof_print_summary(FILE *out){
+    struct prof_thread rows[PROF_MAX_ROWS];
+    uint64_t num_threads[PROF_MAX_ROWS];
+    int num_rows = 0;
+    int total = __atomic_load_n(&prof_num_threads, __ATOMIC_ACQUIRE);
+    int listed = (total > PROF_MAX_THREADS) ? PROF_MAX_THREADS : total;
+
+    for(int i = 0; i < listed; i++){
+        struct prof_thread *th = __atomic_load_n(&prof_threads[i], __ATOMIC_ACQUIRE);
+        if(th != NULL)
+            prof_add_to_row(rows, num_threads, &num_rows, th, 1);
+    }
+    for(int j = 0; j < PROF_MAX_ROWS; j++){
+        uint64_t threads = __atomic_load_n(&prof_overflow_threads[j], __ATOMIC_ACQUIRE);
+        if(threads > 0)
+            prof_add_to_row(rows, num_threads, &num_rows, &prof_overflow[j], threads);
+    }
+
+    fprintf(out, "=====================Profile=====================\n");
+    fprintf(out, "%-10s %7s %9s %10s %13s %10s %7s %9s",
+            "thread", "threads", "acquires", "wait(ms)", "max wait(us)", "hold(ms)", "scans", "scan(ms)");
+    for(int k = 0; k < PROF_NUM_CONDS; k++){
+        char wait_col[32];
+        snprintf(wait_col, sizeof(wait_col), "%s(ms)", prof_cond_names[k]);
+        fprintf(out, " %11s %c-wakeup %c-spur", wait_col, prof_cond_names[k][0], prof_cond_names[k][0]);
+    }
+    fprintf(out, "\n");
+    for(int j = 0; j < num_rows; j++){
+        struct prof_thread *row = &rows[j];
+        fprintf(out, "%-10s %7llu %9llu %10.3lf %13.3lf %10.3lf %7llu %9.3lf",
+                row->name, (unsigned long long)num_threads[j], (unsigned long long)row->lock_acquires,
+                row->lock_wait_ns * 1e-6, row->max_lock_wait_ns * 1e-3, row->lock_hold_ns * 1e-6,
+                (unsigned long long)row->scans, row->scan_ns * 1e-6);
+        for(int k = 0; k < PROF_NUM_CONDS; k++){
+            fprintf(out, " %11.3lf %8llu %6llu", row->cond_wait_ns[k] * 1e-6,
+                    (unsigned long long)row->cond_waits[k], (unsigned long long)row->spurious_wakeups[k]);
+        }
+        fprintf(out, "\n");
+        if(row->dropped_events > 0)
+            fprintf(out, "  (%llu timeline events of '%s' were dropped)\n", (unsigned long long)row->dropped_events, row->name);
+    }
+    if(total > PROF_MAX_THREADS){
+        uint64_t folded = __atomic_load_n(&prof_num_folded, __ATOMIC_ACQUIRE);
+        fprintf(out, "  (%d threads beyond the first %d have no timeline; %llu of them have exited and are included above, "
+                "%llu still running are not)\n", total - PROF_MAX_THREADS, PROF_MAX_THREADS,
+                (unsigned long long)folded, (unsigned long long)(total - PROF_MAX_THREADS - folded));
+    }
+}
+
+/**
+ * Function to write the timeline of all the threads in the Chrome trace event format,
+ * which can be opened in chrome://tracing or ui.perfetto.dev.
+ * @param path Path of the JSON file to be written.
+ */
+void prof_write_trace(const char *path){
+    FILE *fp = fopen(path, "w");
+    if(fp == NULL){
+        printf("Could not open %s for writing the profile trace\n", path);
+        return;
+    }
+    int total = __atomic_load_n(&prof_num_threads, __ATOMIC_ACQUIRE);
+    if(total > PROF_MAX_THREADS)
+        total = PROF_MAX_THREADS;
+
+    bool first = true;
+    fprintf(fp, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n");
+    for(int i = 0; i < total; i++){
+        struct prof_thread *th = __atomic_load_n(&prof_threads[i], __ATOMIC_ACQUIRE);
+        if(th == NULL)
+            continue;
+        fprintf(fp, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"%s %d\"}}",
+                first ? "" : ",\n", th->tid, th->name, th->tid);
+        first = false;
+        int num_events = __atomic_load_n(&(th->num_events), __ATOMIC_ACQUIRE);
+        for(int k = 0; k < num_events; k++){
+            struct prof_event *ev = &(th->events[k]);
+            double ts = (ev->start_ns - prof_epoch_ns) * 1e-3;   /* Trace timestamps are in microseconds */
+            if(ev->kind >= PROF_EV_SPURIOUS_QUEUE){
+                fprintf(fp, ",\n{\"name\":\"%s\",\"cat\":\"allocator\",\"ph\":\"i\",\"s\":\"t\",\"ts\":%.3lf,\"pid\":1,\"tid\":%d}",
+                        prof_event_names[ev->kind], ts, th->tid);
+            }else{
+                fprintf(fp, ",\n{\"name\":\"%s\",\"cat\":\"allocator\",\"ph\":\"X\",\"ts\":%.3lf,\"dur\":%.3lf,\"pid\":1,\"tid\":%d}",
+                        prof_event_names[ev->kind], ts, ev->dur_ns * 1e-3, th->tid);
+            }
+        }
+    }
+    fprintf(fp, "\n]}\n");
+    fclose(fp);
+    printf("Profile trace written to %s\n", path);
+}
+
+/* Print the summary and write the trace to $PROF_TRACE, or profile_trace.json if it is not set */
+void prof_report(){
+    const char *path = getenv("PROF_TRACE");
+    prof_print_summary(stdout);
+    prof_write_trace(path != NULL ? path : "profile_trace.json");
+}
+
+#define PROF_INIT() prof_init()
+#define PROF_THREAD_START(name, max_events) prof_thread_register(name, max_events)
+#define PROF_THREAD_END() prof_thread_end()
+#define PROF_LOCK(mtx) prof_mutex_lock(mtx)
+#define PROF_UNLOCK(mtx) prof_mutex_unlock(mtx)
+#define PROF_COND_WAIT(cond, mtx, kind) prof_cond_wait(cond, mtx, kind)
+#define PROF_SCAN_BEGIN() prof_scan_begin()
+#define PROF_SCAN_END() prof_scan_end()
+#define PROF_REPORT() prof_report()
+
+#else
+
+#define PROF_INIT() ((void)0)
+#define PROF_THREAD_START(name, max_events) ((void)0)
+#define PROF_THREAD_END() ((void)0)
+#define PROF_LOCK(mtx) pthread_mutex_lock(mtx)
+#define PROF_UNLOCK(mtx) pthread_mutex_unlock(mtx)
+#define PROF_COND_WAIT(cond, mtx, kind) pthread_cond_wait(cond, mtx)
+#define PROF_SCAN_BEGIN() ((void)0)
+#define PROF_SCAN_END() ((void)0)
+#define PROF_REPORT() ((void)0)
+
+#endif